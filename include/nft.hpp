@@ -1,41 +1,245 @@
 #pragma once
 
 #include <eosio/asset.hpp>
+#include <eosio/binary_extension.hpp>
+#include <eosio/crypto.hpp>
 #include <eosio/eosio.hpp>
+#include <eosio/singleton.hpp>
+#include <eosio/system.hpp>
 
+#include <optional>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <nft_policy.hpp>
 
 using namespace eosio;
+using std::pair;
 using std::string;
+using std::vector;
 
 class [[eosio::contract("nft")]] nft : public contract {
     public:
         using contract::contract;
+        ~nft();
+
+        enum notify_flags : uint8_t {
+            notify_none = 0,
+            notify_from = 1,
+            notify_to   = 2,
+            notify_both = notify_from | notify_to,
+        };
+
+        enum event_mode : uint8_t {
+            inline_events  = 0, // *log inline actions
+            compact_events = 1, // *log inline actions without memo and data strings
+            return_events  = 2, // events packed into the action return value, no inline actions
+        };
+
+        enum memo_mode : uint8_t {
+            memo_inline   = 0, // memo strings in the transfer events
+            memo_dropped  = 1, // no memos in the transfer events
+            memo_interned = 2, // memos stored once in the memos table, events carry their memo_id
+        };
+
+        struct [[eosio::table]] nft_config {
+            uint8_t    event_mode = inline_events;
+            bool    holder_index = false; // keep the holders table in sync with balances
+            bool    owner_summary = false; // keep the summary table in sync with balances
+            bool    snapshot_hash = false; // fold every balance update into the current epoch root
+            uint8_t    memo_mode = memo_inline;
+        };
+
+        struct table_stats {
+            int64_t    rows = 0;
+            int64_t    bytes = 0; // serialized row bytes, the chain bills a fixed overhead per row on top
+        };
+
+        struct [[eosio::table]] nft_stats {
+            table_stats    collection_rows;
+            table_stats    asset_rows;
+            table_stats    asset_data_rows;
+            table_stats    balance_rows;
+        };
+
+        struct action_counter {
+            name    action;
+            uint64_t    calls = 0;
+            uint64_t    inline_actions = 0; // events and chained actions sent while handling it
+        };
+
+        // hot-path counters, only kept by builds with NFT_COUNTERS=1
+        struct [[eosio::table]] nft_counters {
+            vector<action_counter>    actions; // sorted by action
+            uint64_t    balance_emplaces = 0;
+            uint64_t    balance_modifies = 0;
+            uint64_t    balance_erases = 0;
+            uint64_t    unique_moves = 0;
+            uint64_t    bytes_written = 0; // serialized bytes of the balance and unique asset rows written
+        };
+
+        struct nft_event {
+            name    event;
+            vector<char>    data;
+        };
+
+        struct asset_spec {
+            uint64_t    supply;
+            uint64_t    max_supply;
+            string     data;
+            vector<uint16_t>    attributes;
+            bool    unique; // 1-of-1 owned through the asset row, supply and max_supply must be 1
+        };
+
+        struct transfer_leg {
+            name    to;
+            uint64_t    asset_id;
+            int64_t    amount;
+        };
+
+        struct sale_leg {
+            name    from;
+            name    to;
+            uint64_t    asset_id;
+            int64_t    amount;
+            asset    price;
+        };
+
+        struct transfer_entry {
+            name    to;
+            uint64_t    asset_id;
+            int64_t    amount;
+            int64_t    from_balance;
+            int64_t    to_balance;
+        };
 
         [[eosio::action]] void createcol(const name& author, uint16_t royalty, const string& data);
+        [[eosio::action]] void setmetauri(uint64_t collection_id, const checksum256& hash, const string& uri);
+        [[eosio::action]] void settemplate(uint64_t collection_id, const string& tmpl);
+        [[eosio::action]] void compactcol(uint64_t collection_id, const string& data);
+        [[eosio::action]] void settrait(uint64_t collection_id, uint16_t trait_id, const string& trait_type, const vector<string>& values);
         [[eosio::action]] void createasset(uint64_t collection_id, uint64_t supply, uint64_t max_supply, const string& data);
+        [[eosio::action]] void createassets(uint64_t collection_id, const vector<asset_spec>& specs);
+        [[eosio::action]] void setattrs(uint64_t asset_id, const vector<uint16_t>& attributes);
+        [[eosio::action]] void closeasset(uint64_t asset_id, bool erase);
 
         [[eosio::action]] void mint(const name& to, uint64_t asset_id, int64_t amount, const string& memo);
+        [[eosio::action]] void mintto(const name& to, uint64_t asset_id, int64_t amount, const string& memo);
+        [[eosio::action]] void mintbatch(uint64_t asset_id, const vector<pair<name, int64_t>>& recipients, const string& memo);
+        [[eosio::action]] void enqueue(uint64_t asset_id, const vector<pair<name, int64_t>>& recipients);
+        [[eosio::action]] void process(const name& cranker, uint32_t max_legs);
         [[eosio::action]] void burn(uint64_t asset_id, int64_t amount, const string& memo);
+        [[eosio::action]] void redeem(const name& owner, uint64_t asset_id, int64_t amount, const string& memo);
         [[eosio::action]] void transfer(const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo);
+        [[eosio::action]] void transfernn(const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo, bool notify_to);
+        [[eosio::action]] void transfers(const name& from, const vector<transfer_leg>& legs, const string& memo);
+        [[eosio::action]] void transferfrom(const name& spender, const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo);
+
+        [[eosio::action]] void settle(const name& spender, const name& token_contract, const vector<sale_leg>& legs, const string& memo);
+
+        // approvals
+        [[eosio::action]] void approve(const name& owner, const name& spender, uint64_t asset_id, int64_t amount);
+        [[eosio::action]] void approveall(const name& owner, const name& spender, bool approved);
+
+        // maintenance
+        [[eosio::action]] void setconfig(const nft_config& cfg);
+        [[eosio::action]] void migrate(uint32_t max_rows);
+        [[eosio::action]] void newepoch();
+        [[eosio::action]] void reindex(const name& owner, uint64_t from_asset_id, uint32_t max_rows);
+        [[eosio::action]] void rebuildsum(const name& owner);
+        [[eosio::action]] void setstats(const nft_stats& seed);
+        [[eosio::action]] nft_stats getstats();
+        [[eosio::action]] nft_counters getcounters();
+
+#ifdef NFT_BENCHMARK
+        [[eosio::action]] void benchbalance(const name& owner, uint64_t asset_id, uint32_t iterations);
+#endif
 
         // events
         [[eosio::action]] void collog(uint64_t collection_id, name author, uint16_t royalty, const string& data) { require_auth(_self); }
         [[eosio::action]] void assetlog(uint64_t asset_id, uint64_t collection_id, uint64_t max_supply, const string& data) { require_auth(_self); }
-        [[eosio::action]] void transferlog(const name& from, const name& to, uint64_t asset_id, int64_t amount, int64_t from_balance, int64_t to_balance, const string& memo) { require_auth(_self); }
+        [[eosio::action]] void assetslog(uint64_t collection_id, uint64_t first_asset_id, uint64_t last_asset_id) { require_auth(_self); }
+        [[eosio::action]] void transferlog(const name& from, const name& to, uint64_t asset_id, int64_t amount, int64_t from_balance, int64_t to_balance, const string& memo, binary_extension<uint32_t> memo_id) { require_auth(_self); }
+        [[eosio::action]] void transferslog(const name& from, const vector<transfer_entry>& transfers, const string& memo, binary_extension<uint32_t> memo_id) { require_auth(_self); }
 
     private:
         const permission_level self_perm = permission_level{_self, "active"_n};
 
+        // root = sha256(pack(root, owner, asset_id, balance)) over every balance update, chained across epochs
+        struct [[eosio::table]] nft_epoch {
+            uint64_t    epoch;
+            checksum256    root;
+            uint64_t    updates;
+            time_point_sec    started;
+
+            uint64_t primary_key()const { return epoch; }
+        };
+
+        std::optional<nft_config> _config;
+        std::optional<nft_stats> _stats;
+        std::optional<nft_epoch> _epoch;
+        vector<nft_event> _events;
+        std::optional<nft_counters> _counters;
+        name _entry; // outermost action handled, for the counters
+
         struct [[eosio::table]] nft_collection {
             uint64_t  collection_id;
             name    author;
             uint16_t    royalty;
             string     data;
+            // off-chain metadata, asset metadata is meta_uri with {asset_id} substituted
+            binary_extension<checksum256>    meta_hash;
+            binary_extension<string>    meta_uri;
+            // json shared by all assets, asset data only holds the fields that override it
+            binary_extension<string>    meta_template;
             uint64_t primary_key()const { return collection_id; }
+            bool offchain()const { return meta_uri.has_value() && !meta_uri.value().empty(); }
         };
 
+        // author and royalty are copied from the collection so mint/burn never load it
         struct [[eosio::table]] nft_asset {
+            uint64_t  asset_id;
+            uint64_t  collection_id;
+            name    author;
+            uint16_t    royalty;
+            uint64_t    supply;
+            uint64_t    max_supply;
+            bool    is_unique = false; // owned through the owners table, no balances rows
+            uint64_t primary_key()const { return asset_id; }
+            uint64_t by_collection()const { return collection_id; }
+            bool unique()const { return is_unique; }
+        };
+
+        // owner of a unique asset, kept apart from assetcore so only unique assets pay for the byowner index
+        struct [[eosio::table]] nft_owner {
+            uint64_t    asset_id;
+            name    owner;
+
+            uint64_t primary_key()const { return asset_id; }
+            uint64_t by_owner()const { return owner.value; }
+        };
+
+        // attributes[i] is the index into the values of trait i, or no_trait_value
+        struct [[eosio::table]] nft_asset_data {
+            uint64_t  asset_id;
+            string     data;
+            vector<uint16_t>    attributes;
+            uint64_t primary_key()const { return asset_id; }
+        };
+
+        // scoped by collection_id, trait ids are dense from 0
+        struct [[eosio::table]] nft_trait {
+            uint16_t    trait_id;
+            string     trait_type;
+            vector<string>    values;
+            uint64_t primary_key()const { return trait_id; }
+        };
+
+        static constexpr uint16_t no_trait_value = 0xffff;
+
+        // layout of the assets table before data was split out, only read by migrate
+        struct [[eosio::table]] nft_asset_legacy {
             uint64_t  asset_id;
             uint64_t  collection_id;
             uint64_t    supply;
@@ -47,15 +251,127 @@ class [[eosio::contract("nft")]] nft : public contract {
         struct [[eosio::table]] nft_balance {
             uint64_t    asset_id;
             int64_t    balance;
+            // missing on rows created before it was added, those are not in bycollection until reindex
+            binary_extension<uint64_t>    collection_id;
 
             uint64_t primary_key()const { return asset_id; }
+            uint64_t by_collection()const { return collection_id.value_or(0); }
+        };
+
+        // scoped by owner, distinct assets held per collection, collection_id 0 holds the total
+        struct [[eosio::table]] nft_summary {
+            uint64_t    collection_id;
+            uint64_t    assets;
+
+            uint64_t primary_key()const { return collection_id; }
+        };
+
+        struct asset_allowance {
+            uint64_t    asset_id;
+            int64_t    amount;
+        };
+
+        // scoped by owner, what spender may move out of the owner's balances
+        struct [[eosio::table]] nft_approval {
+            name    spender;
+            bool    all_assets;
+            vector<asset_allowance>    allowances;
+
+            uint64_t primary_key()const { return spender.value; }
+        };
+
+        // scoped by asset_id, mirrors the balances rows of that asset
+        struct [[eosio::table]] nft_holder {
+            name    owner;
+            int64_t    balance;
+
+            uint64_t primary_key()const { return owner.value; }
+        };
+
+        // next ids to hand out, ids are never reused even if rows are erased
+        struct [[eosio::table]] nft_global {
+            uint64_t    next_collection_id;
+            uint64_t    next_asset_id;
+            uint64_t    next_queue_id = 0;
+            uint64_t    queue_cursor = 0; // next queue row process will credit
+        };
+
+        // pending airdrop leg, supply is reserved when it is queued
+        struct [[eosio::table]] nft_queued_mint {
+            uint64_t    id;
+            uint64_t    asset_id;
+            name    to;
+            int64_t    amount;
+
+            uint64_t primary_key()const { return id; }
+        };
+
+        // interned transfer memos, rows are never erased so memo ids stay valid in history
+        struct [[eosio::table]] nft_memo {
+            uint64_t    memo_id;
+            checksum256    hash;
+            string    memo;
+
+            uint64_t primary_key()const { return memo_id; }
+            checksum256 by_hash()const { return hash; }
         };
 
         typedef eosio::multi_index< "collections"_n, nft_collection> collections;
-        typedef eosio::multi_index< "assets"_n, nft_asset> assets;
-        typedef eosio::multi_index< "balances"_n, nft_balance > balances;
+        typedef eosio::multi_index< "assetcore"_n, nft_asset,
+            indexed_by< "bycollection"_n, const_mem_fun<nft_asset, uint64_t, &nft_asset::by_collection> >
+        > assets;
+        typedef eosio::multi_index< "owners"_n, nft_owner,
+            indexed_by< "byowner"_n, const_mem_fun<nft_owner, uint64_t, &nft_owner::by_owner> >
+        > owners;
+        typedef eosio::multi_index< "assetdata"_n, nft_asset_data> assetdata;
+        typedef eosio::multi_index< "traits"_n, nft_trait> traits;
+        typedef eosio::multi_index< "assets"_n, nft_asset_legacy> legacy_assets;
+        typedef eosio::multi_index< "balances"_n, nft_balance,
+            indexed_by< "bycollection"_n, const_mem_fun<nft_balance, uint64_t, &nft_balance::by_collection> >
+        > balances;
+        typedef eosio::multi_index< "summary"_n, nft_summary > summaries;
+        typedef eosio::multi_index< "epochs"_n, nft_epoch > epochs;
+        typedef eosio::multi_index< "holders"_n, nft_holder > holders;
+        typedef eosio::multi_index< "approvals"_n, nft_approval > approvals;
+        typedef eosio::singleton< "global"_n, nft_global > global;
+        typedef eosio::multi_index< "queue"_n, nft_queued_mint > queue;
+        typedef eosio::multi_index< "memos"_n, nft_memo,
+            indexed_by< "byhash"_n, const_mem_fun<nft_memo, checksum256, &nft_memo::by_hash> >
+        > memos;
+        typedef eosio::singleton< "config"_n, nft_config > config;
+        typedef eosio::singleton< "stats"_n, nft_stats > stats;
+        typedef eosio::singleton< "counters"_n, nft_counters > counters;
+
+        const nft_config& get_config();
+        nft_stats& get_stats();
+        nft_counters& get_counters();
+        void count_action( name entry );
+        void count_inline();
+        void count_write( uint64_t nft_counters::* branch, uint64_t bytes );
+        void track_rows( table_stats nft_stats::* table, int64_t rows, int64_t bytes );
+        string logged( const string& text );
+        // interned is false on holder-driven paths, which keep their memos inline
+        string logged_memo( const string& memo, bool interned = true );
+        binary_extension<uint32_t> memo_ref( const string& memo, const name& payer );
+        template<typename T> void emit( name event, const T& data );
+
+        nft_global get_global( global& globaltable );
+        uint64_t next_collection_id();
+        uint64_t next_asset_ids( uint64_t count );
 
-        int64_t sub_balance( const name& owner, uint64_t asset_id, int64_t amount );
-        int64_t add_balance( const name& owner, uint64_t asset_id, int64_t amount, const name& ram_payer );
+        void do_transfer( const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo, const name& ram_payer, uint8_t notify = notify_both );
+        void move_unique( const nft_asset& ast, const name& from, const name& to, int64_t amount, const name& ram_payer );
+        int64_t retire( assets& assetstable, const nft_asset& ast, const name& owner, int64_t amount );
+        void spend_allowance( const name& owner, const name& spender, uint64_t asset_id, int64_t amount );
+        void check_attributes( traits& traitstable, const vector<uint16_t>& attributes );
+        nft_epoch& get_epoch();
+        void save_epoch();
+        void hash_balance( const name& owner, uint64_t asset_id, int64_t balance );
+        void count_holding( const name& owner, uint64_t collection_id, int64_t delta, const name& ram_payer );
+        void update_holder( uint64_t asset_id, const name& owner, int64_t balance, const name& ram_payer );
+        int64_t sub_balance( const name& owner, uint64_t asset_id, int64_t amount, const name& ram_payer );
+        int64_t sub_balance( balances& from_blns, const name& owner, uint64_t asset_id, int64_t amount, const name& ram_payer );
+        int64_t add_balance( const name& owner, uint64_t asset_id, uint64_t collection_id, int64_t amount, const name& ram_payer );
+        int64_t add_balance( balances& to_blns, const name& owner, uint64_t asset_id, uint64_t collection_id, int64_t amount, const name& ram_payer );
         
 };
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+// build-time limits and features of the contract, each can be overridden with a -D define,
+// see the NFT_* cache variables in CMakeLists.txt
+
+#ifndef NFT_MAX_DATA_SIZE
+#define NFT_MAX_DATA_SIZE 65535
+#endif
+
+#ifndef NFT_MAX_MEMO_SIZE
+#define NFT_MAX_MEMO_SIZE 256
+#endif
+
+#ifndef NFT_MAX_ROYALTY
+#define NFT_MAX_ROYALTY 1000
+#endif
+
+// 0 leaves memos out of the *log events
+#ifndef NFT_LOG_MEMOS
+#define NFT_LOG_MEMOS 1
+#endif
+
+// 0 rejects on-chain collection and asset data, metadata then lives behind setmetauri
+#ifndef NFT_ONCHAIN_METADATA
+#define NFT_ONCHAIN_METADATA 1
+#endif
+
+// 1 only allows unique 1-of-1 assets, which drops the balance path from transfers
+#ifndef NFT_UNIQUE_ONLY
+#define NFT_UNIQUE_ONLY 0
+#endif
+
+// 1 keeps row and byte counts per table in the stats singleton, at one singleton write per action that adds or erases rows
+#ifndef NFT_ROW_STATS
+#define NFT_ROW_STATS 0
+#endif
+
+// 1 keeps per-action and balance branch counters in the counters singleton
+#ifndef NFT_COUNTERS
+#define NFT_COUNTERS 0
+#endif
+
+#define NFT_STR_(x) #x
+#define NFT_STR(x) NFT_STR_(x)
+
+namespace policy {
+    static constexpr uint32_t max_data_size = NFT_MAX_DATA_SIZE;
+    static constexpr uint32_t max_memo_size = NFT_MAX_MEMO_SIZE;
+    static constexpr uint16_t max_royalty   = NFT_MAX_ROYALTY;
+
+    static constexpr bool log_memos        = NFT_LOG_MEMOS;
+    static constexpr bool onchain_metadata = NFT_ONCHAIN_METADATA;
+    static constexpr bool unique_only      = NFT_UNIQUE_ONLY;
+    static constexpr bool row_stats        = NFT_ROW_STATS;
+    static constexpr bool counters         = NFT_COUNTERS;
+
+    static constexpr const char* data_too_long     = "data has more than " NFT_STR(NFT_MAX_DATA_SIZE) " bytes";
+    static constexpr const char* template_too_long = "template has more than " NFT_STR(NFT_MAX_DATA_SIZE) " bytes";
+    static constexpr const char* memo_too_long     = "memo has more than " NFT_STR(NFT_MAX_MEMO_SIZE) " bytes";
+    static constexpr const char* royalty_too_high  = "royalty must be less than " NFT_STR(NFT_MAX_ROYALTY);
+
+    // royalties are in 1/10000 of the price
+    static_assert(max_royalty <= 10000, "royalty bound exceeds 100%");
+}
@@ -1,15 +1,16 @@
-import { Api, JsonRpc } from 'eosjs';
+import { Api, JsonRpc, RpcError } from 'eosjs';
 import { JsSignatureProvider } from 'eosjs/dist/eosjs-jssig.js';
 import fetch from 'node-fetch'; 
 import { TextEncoder, TextDecoder } from 'util';
 
-const defaultPrivateKey = 'Your private key';
+// NFT_KEY, NFT_RPC and NFT_CONTRACT point the helpers at another chain, such as a local test node
+const defaultPrivateKey = process.env.NFT_KEY || 'Your private key';
 const signatureProvider = new JsSignatureProvider([defaultPrivateKey]);
 
-const rpc = new JsonRpc('https://eospush.tokenpocket.pro', { fetch });
+const rpc = new JsonRpc(process.env.NFT_RPC || 'https://eospush.tokenpocket.pro', { fetch });
 const api = new Api({ rpc, signatureProvider, textDecoder: new TextDecoder(), textEncoder: new TextEncoder() });
 
-const nftContract = 'your eos account';
+const nftContract = process.env.NFT_CONTRACT || 'your eos account';
 
 async function createCol({ author, royalty, name, image, banner, description, links }) {
   if (!author || !royalty || !name || !image || !banner || typeof links != 'object') {
@@ -38,7 +39,7 @@ async function createCol({ author, royalty, name, image, banner, description, li
 };
 
 
-async function createAsset({ collection_id, supply, max_supply, name, image, animation_url, external_url, description, attributes }) {
+function createAssetAction({ collection_id, supply, max_supply, name, image, animation_url, external_url, description, attributes }) {
   if (!collection_id || !supply || !max_supply || !name || !image || !description || !Array.isArray(attributes) ) {
     throw new Error('Missing parameters');
   }
@@ -49,6 +50,61 @@ async function createAsset({ collection_id, supply, max_supply, name, image, ani
   if (external_url) {
     data.external_url = external_url;
   }
+  return {
+    account: nftContract,
+    name: 'createasset',
+    authorization: [{
+      actor: nftContract,
+      permission: 'active',
+    }],
+    data: {
+      collection_id,
+      supply,
+      max_supply,
+      data: JSON.stringify(data),
+    },
+  };
+}
+
+async function createAsset(asset) {
+  const result = await api.transact({
+    actions: [createAssetAction(asset)]
+  }, {
+    blocksBehind: 3,
+    expireSeconds: 30,
+  });
+  return result;
+};
+
+async function setTemplate(collection_id, template) {
+  if (!collection_id || typeof template != 'object') {
+    throw new Error('Missing parameters');
+  }
+  const result = await api.transact({
+    actions: [{
+      account: nftContract,
+      name: 'settemplate',
+      authorization: [{
+        actor: nftContract,
+        permission: 'active',
+      }],
+      data: {
+        collection_id,
+        tmpl: JSON.stringify(template),
+      },
+    }]
+  }, {
+    blocksBehind: 3,
+    expireSeconds: 30,
+  });
+  return result;
+};
+
+// for collections with a template, data holds only the fields that differ from it
+async function createAssetDelta({ collection_id, supply, max_supply, ...fields }) {
+  if (!collection_id || !supply || !max_supply) {
+    throw new Error('Missing parameters');
+  }
   const result = await api.transact({
     actions: [{
       account: nftContract,
@@ -61,7 +117,7 @@ async function createAsset({ collection_id, supply, max_supply, name, image, ani
         collection_id,
         supply,
         max_supply,
-        data: JSON.stringify(data),
+        data: JSON.stringify(fields),
       },
     }]
   }, {
@@ -71,23 +127,64 @@ async function createAsset({ collection_id, supply, max_supply, name, image, ani
   return result;
 };
 
-async function mint(to, asset_id, amount, memo) {
-  if (!asset_id || !amount || !to) {
+// schema is the collection's traits in trait id order: [{ trait_type, values: [...] }]
+const NO_TRAIT_VALUE = 0xffff;
+
+function encodeAttributes(schema, attributes) {
+  return schema.map(({ trait_type, values }) => {
+    const attr = attributes.find(a => a.trait_type == trait_type);
+    if (!attr) {
+      return NO_TRAIT_VALUE;
+    }
+    const index = values.indexOf(attr.value);
+    if (index < 0) {
+      throw new Error('Unknown value ' + attr.value + ' for trait ' + trait_type);
+    }
+    return index;
+  });
+}
+
+async function setTrait(collection_id, trait_id, trait_type, values) {
+  if (!collection_id || trait_id === undefined || !trait_type || !Array.isArray(values)) {
     throw new Error('Missing parameters');
   }
   const result = await api.transact({
     actions: [{
       account: nftContract,
-      name: 'mint',
+      name: 'settrait',
+      authorization: [{
+        actor: nftContract,
+        permission: 'active',
+      }],
+      data: {
+        collection_id,
+        trait_id,
+        trait_type,
+        values,
+      },
+    }]
+  }, {
+    blocksBehind: 3,
+    expireSeconds: 30,
+  });
+  return result;
+};
+
+async function setAttributes(asset_id, attributes) {
+  if (!asset_id || !Array.isArray(attributes)) {
+    throw new Error('Missing parameters');
+  }
+  const result = await api.transact({
+    actions: [{
+      account: nftContract,
+      name: 'setattrs',
       authorization: [{
         actor: nftContract,
         permission: 'active',
       }],
       data: {
-        to,
         asset_id,
-        amount,
-        memo
+        attributes,
       },
     }]
   }, {
@@ -97,6 +194,36 @@ async function mint(to, asset_id, amount, memo) {
   return result;
 };
 
+function mintAction(to, asset_id, amount, memo) {
+  if (!asset_id || !amount || !to) {
+    throw new Error('Missing parameters');
+  }
+  return {
+    account: nftContract,
+    name: 'mint',
+    authorization: [{
+      actor: nftContract,
+      permission: 'active',
+    }],
+    data: {
+      to,
+      asset_id,
+      amount,
+      memo
+    },
+  };
+}
+
+async function mint(to, asset_id, amount, memo) {
+  const result = await api.transact({
+    actions: [mintAction(to, asset_id, amount, memo)]
+  }, {
+    blocksBehind: 3,
+    expireSeconds: 30,
+  });
+  return result;
+};
+
 async function transfer(from, to, asset_id, amount, memo) {
   if (!from || !to  || !asset_id || !amount) {
     throw new Error('Missing parameters');
@@ -124,4 +251,115 @@ async function transfer(from, to, asset_id, amount, memo) {
   return result;
 }
 
-export { createCol, createAsset, mint, transfer }
\ No newline at end of file
+// needs a contract built with -DNFT_BENCHMARK=ON
+async function benchBalance(owner, asset_id, iterations) {
+  if (!owner || !asset_id || iterations === undefined) {
+    throw new Error('Missing parameters');
+  }
+  const result = await api.transact({
+    actions: [{
+      account: nftContract,
+      name: 'benchbalance',
+      authorization: [{
+        actor: owner,
+        permission: 'active',
+      }],
+      data: {
+        owner,
+        asset_id,
+        iterations
+      },
+    }]
+  }, {
+    blocksBehind: 3,
+    expireSeconds: 30,
+  });
+  return result;
+}
+
+// reference block for bulk transactions, shared until it is older than taposTtl
+const taposTtl = 60 * 1000;
+let tapos = null;
+
+async function getTapos() {
+  if (!tapos || Date.now() - tapos.fetched > taposTtl) {
+    const info = await rpc.get_info();
+    const block = await rpc.get_block(info.last_irreversible_block_num);
+    tapos = {
+      fetched: Date.now(),
+      head: new Date(info.head_block_time + 'Z').getTime(),
+      ref_block_num: block.block_num & 0xffff,
+      ref_block_prefix: block.ref_block_prefix,
+    };
+  }
+  return tapos;
+}
+
+function isDuplicate(e) {
+  return e instanceof RpcError && e.json && e.json.error && e.json.error.name == 'tx_duplicate';
+}
+
+// identical batches signed in the same second would share a transaction id, so each batch
+// gets its own expiration second, counted across calls
+const maxExpireSeconds = 3600;
+let batchSerial = 0;
+
+// packs actions perTransaction at a time and keeps up to concurrency transactions in flight.
+// each transaction is signed once and the same bytes are pushed on retry, so a retry of one
+// that already landed fails as a duplicate instead of applying twice.
+// returns the transaction results in the order of the actions.
+async function submitBulk(actions, { perTransaction = 50, concurrency = 4, retries = 3, expireSeconds = 300, onResult } = {}) {
+  if (expireSeconds >= maxExpireSeconds) {
+    throw new Error('expireSeconds must be less than ' + maxExpireSeconds);
+  }
+  const batches = [];
+  for (let i = 0; i < actions.length; i += perTransaction) {
+    batches.push(actions.slice(i, i + perTransaction));
+  }
+  const results = new Array(batches.length);
+  let next = 0;
+
+  async function submit(index) {
+    const { fetched, head, ref_block_num, ref_block_prefix } = await getTapos();
+    const offset = batchSerial++ % (maxExpireSeconds - expireSeconds);
+    // the api caches the chain id and contract abi after the first transaction
+    const signed = await api.transact({
+      expiration: new Date(head + Date.now() - fetched + (expireSeconds + offset) * 1000).toISOString().slice(0, -1),
+      ref_block_num,
+      ref_block_prefix,
+      actions: batches[index],
+    }, { broadcast: false, sign: true });
+    for (let attempt = 0; ; attempt++) {
+      try {
+        return await api.pushSignedTransaction(signed);
+      } catch (e) {
+        // only a retry can collide with our own earlier push, a duplicate on the first push is another transaction
+        if (isDuplicate(e)) {
+          if (attempt > 0) {
+            return { duplicate: true };
+          }
+          throw e;
+        }
+        if (attempt >= retries) {
+          throw e;
+        }
+        await new Promise(resolve => setTimeout(resolve, 500 * 2 ** attempt));
+      }
+    }
+  }
+
+  async function worker() {
+    while (next < batches.length) {
+      const index = next++;
+      results[index] = await submit(index);
+      if (onResult) {
+        onResult(results[index], index, batches.length);
+      }
+    }
+  }
+
+  await Promise.all(Array.from({ length: Math.min(concurrency, batches.length) }, worker));
+  return results;
+}
+
+export { api, rpc, nftContract, submitBulk, createCol, createAssetAction, createAsset, setTemplate, createAssetDelta, encodeAttributes, setTrait, setAttributes, mintAction, mint, transfer, benchBalance }
\ No newline at end of file
@@ -0,0 +1,141 @@
+import { RpcError } from 'eosjs';
+import { readFileSync, writeFileSync } from 'fs';
+import { api, rpc, nftContract } from './actions.js';
+
+// usage: NFT_RPC=http://127.0.0.1:8888 NFT_KEY=<key> NFT_CONTRACT=<contract> NFT_AUTHOR=<author> NFT_HOLDERS=<a,b,...> node bench.js
+// runs each workload against a test chain and prints billed cpu, net and ram deltas per action.
+// the key must sign for the contract, the author and the holders; the contract must use the inline event mode.
+// with a contract built with -DNFT_BENCHMARK=ON the balance hot path is measured too.
+// NFT_BASELINE=<file.json> fails the run when a workload's cpu, net or ram exceeds the baseline by more than
+// NFT_TOLERANCE (default 0.1 for 10%); NFT_WRITE_BASELINE=<file.json> saves this run as a baseline.
+// exits non-zero on any error or regression.
+const author = process.env.NFT_AUTHOR;
+const holders = (process.env.NFT_HOLDERS || '').split(',').filter(Boolean);
+const batchLegs = 10;
+
+function act(name, actor, data) {
+  return {
+    account: nftContract,
+    name,
+    authorization: [{
+      actor,
+      permission: 'active',
+    }],
+    data,
+  };
+}
+
+async function push(actions) {
+  const result = await api.transact({ actions }, {
+    blocksBehind: 3,
+    expireSeconds: 30,
+  });
+  const receipt = result.processed.receipt;
+  let ram = 0;
+  for (const trace of result.processed.action_traces) {
+    for (const delta of trace.account_ram_deltas || []) {
+      ram += delta.delta;
+    }
+  }
+  return { cpu: receipt.cpu_usage_us, net: receipt.net_usage_words * 8, ram };
+}
+
+async function nextIds() {
+  const { rows } = await rpc.get_table_rows({ code: nftContract, scope: nftContract, table: 'global' });
+  return rows.length ? rows[0] : null;
+}
+
+const report = [];
+
+function record(workload, legs, { cpu, net, ram }) {
+  report.push({ workload, legs, cpu_us: cpu, cpu_us_per_leg: +(cpu / legs).toFixed(1), net_bytes: net, ram_bytes: ram });
+}
+
+async function measure(workload, legs, actions) {
+  record(workload, legs, await push(actions));
+}
+
+// returns the workloads whose cpu, net or ram grew beyond the tolerance
+function regressions(baseline, tolerance) {
+  const failed = [];
+  for (const row of report) {
+    const base = baseline[row.workload];
+    if (!base) {
+      continue;
+    }
+    for (const key of ['cpu_us', 'net_bytes', 'ram_bytes']) {
+      // a slack of 1 keeps zero baselines from failing on noise-free metrics
+      if (row[key] > base[key] * (1 + tolerance) + 1) {
+        failed.push(`${row.workload} ${key}: ${row[key]} > ${base[key]}`);
+      }
+    }
+  }
+  return failed;
+}
+
+(async () => {
+  try {
+    if (!author || holders.length == 0) {
+      throw new Error('Missing NFT_AUTHOR or NFT_HOLDERS');
+    }
+
+    await measure('createcol', 1, [act('createcol', nftContract, { author, royalty: 100, data: 'x'.repeat(1024) })]);
+    const collection_id = (await nextIds()).next_collection_id - 1;
+
+    await measure('createasset 1KB', 1, [act('createasset', author, { collection_id, supply: 0, max_supply: 1000000, data: 'x'.repeat(1024) })]);
+    await measure('createasset 64KB', 1, [act('createasset', author, { collection_id, supply: 0, max_supply: 1000000, data: 'x'.repeat(65535) })]);
+    const asset_id = (await nextIds()).next_asset_id - 2;
+
+    await measure('mint', 1, [act('mint', author, { to: author, asset_id, amount: 1000, memo: 'bench' })]);
+    await measure('mintto', 1, [act('mintto', author, { to: holders[0], asset_id, amount: 1, memo: 'bench' })]);
+    await measure('transfer', 1, [act('transfer', author, { from: author, to: holders[0], asset_id, amount: 1, memo: 'bench' })]);
+
+    const legs = Array.from({ length: batchLegs }, (_, i) => ({ to: holders[i % holders.length], asset_id, amount: 1 }));
+    await measure('transfers', batchLegs, [act('transfers', author, { from: author, legs, memo: 'bench' })]);
+
+    const recipients = legs.map(l => ({ first: l.to, second: 1 }));
+    await measure('mintbatch', batchLegs, [act('mintbatch', author, { asset_id, recipients, memo: 'bench' })]);
+
+    const specs = Array.from({ length: batchLegs }, () => ({ supply: 1, max_supply: 1, data: 'x'.repeat(1024), attributes: [], unique: false }));
+    await measure('createassets 1KB', batchLegs, [act('createassets', author, { collection_id, specs })]);
+
+    const unique = specs.map(s => ({ ...s, unique: true }));
+    await measure('createassets unique', batchLegs, [act('createassets', author, { collection_id, specs: unique })]);
+    const unique_id = (await nextIds()).next_asset_id - 1;
+    await measure('transfer unique', 1, [act('transfer', author, { from: author, to: holders[0], asset_id: unique_id, amount: 1, memo: 'bench' })]);
+
+    await measure('burn', 1, [act('burn', author, { asset_id, amount: 1, memo: 'bench' })]);
+
+    const abi = await rpc.get_abi(nftContract);
+    if (abi.abi.actions.some(a => a.name == 'benchbalance')) {
+      // the 0 iteration run is the fixed action overhead, leaving the balance updates in the difference
+      const empty = await push([act('benchbalance', author, { owner: author, asset_id, iterations: 0 })]);
+      const full = await push([act('benchbalance', author, { owner: author, asset_id, iterations: 100 })]);
+      record('benchbalance x100', 100, { cpu: full.cpu - empty.cpu, net: full.net - empty.net, ram: full.ram - empty.ram });
+    }
+
+    console.table(report);
+
+    if (process.env.NFT_WRITE_BASELINE) {
+      const baseline = Object.fromEntries(report.map(({ workload, ...row }) => [workload, row]));
+      writeFileSync(process.env.NFT_WRITE_BASELINE, JSON.stringify(baseline, null, 2) + '\n');
+    }
+    if (process.env.NFT_BASELINE) {
+      const baseline = JSON.parse(readFileSync(process.env.NFT_BASELINE, 'utf8'));
+      const failed = regressions(baseline, Number(process.env.NFT_TOLERANCE || 0.1));
+      if (failed.length) {
+        console.log('Regressions:\n' + failed.join('\n'));
+        process.exitCode = 1;
+      }
+    }
+  } catch (e) {
+    if (e instanceof RpcError) {
+      const err = e.json.error;
+      console.log('EOS error:', err.name + ',', err.what);
+      console.log('Error detail:', err.details[0].message);
+    } else {
+      console.log(e);
+    }
+    process.exitCode = 1;
+  }
+})();
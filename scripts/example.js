@@ -1,5 +1,5 @@
 import { RpcError } from 'eosjs';
-import { createCol, createAsset } from './actions.js';
+import { createCol, createAssetAction, submitBulk } from './actions.js';
 
 (async () => {
   try {
@@ -18,8 +18,7 @@ import { createCol, createAsset } from './actions.js';
     const result = await createCol(collection);
     console.log(result);
 
-    await  new Promise(resolve => setTimeout(resolve, 2000));
-
+    const actions = [];
     for (let i = 1; i <= 50; i++) {
       const asset = {
         collection_id: 1,
@@ -34,9 +33,11 @@ import { createCol, createAsset } from './actions.js';
           { trait_type: 'number', value: '#' + i },
         ],
       };
-      const result = await createAsset(asset);
-      console.log(result);
+      actions.push(createAssetAction(asset));
     }
+    // 50 assets per transaction, 4 transactions in flight
+    const results = await submitBulk(actions, { perTransaction: 50, concurrency: 4 });
+    console.log(results);
   } catch (e) {
     if (e instanceof RpcError) {
       const err = e.json.error;
@@ -1,35 +1,280 @@
 #include <nft.hpp>
 
+#include <algorithm>
+#include <limits>
+
+nft::~nft() {
+    if (!_events.empty()) {
+        auto packed = pack(_events);
+        internal_use_do_not_use::set_action_return_value(packed.data(), packed.size());
+    }
+
+    // row accounting is written once per action
+    if constexpr (policy::row_stats) {
+        if (_stats) {
+            stats statstable(get_self(), get_self().value);
+            statstable.set(*_stats, _self);
+        }
+    }
+
+    if (_epoch) {
+        save_epoch();
+    }
+
+    if constexpr (policy::counters) {
+        if (_counters) {
+            counters counterstable(get_self(), get_self().value);
+            counterstable.set(*_counters, _self);
+        }
+    }
+}
+
+const nft::nft_config& nft::get_config() {
+    if (!_config) {
+        config configtable(get_self(), get_self().value);
+        _config = configtable.get_or_default();
+    }
+    return *_config;
+}
+
+nft::nft_stats& nft::get_stats() {
+    if (!_stats) {
+        stats statstable(get_self(), get_self().value);
+        _stats = statstable.get_or_default();
+    }
+    return *_stats;
+}
+
+nft::nft_counters& nft::get_counters() {
+    if (!_counters) {
+        counters counterstable(get_self(), get_self().value);
+        _counters = counterstable.get_or_default();
+    }
+    return *_counters;
+}
+
+void nft::count_action(name entry) {
+    if constexpr (policy::counters) {
+        // actions called from another action's body count towards the outer one
+        if (_entry) {
+            return;
+        }
+        _entry = entry;
+
+        auto& actions = get_counters().actions;
+        auto it = std::lower_bound(actions.begin(), actions.end(), entry, [](const action_counter& c, name n) { return c.action < n; });
+        if (it == actions.end() || it->action != entry) {
+            it = actions.insert(it, action_counter{entry});
+        }
+        it->calls++;
+    }
+}
+
+void nft::count_inline() {
+    if constexpr (policy::counters) {
+        if (!_entry) {
+            return;
+        }
+        auto& actions = get_counters().actions;
+        auto it = std::lower_bound(actions.begin(), actions.end(), _entry, [](const action_counter& c, name n) { return c.action < n; });
+        it->inline_actions++;
+    }
+}
+
+void nft::count_write(uint64_t nft_counters::* branch, uint64_t bytes) {
+    if constexpr (policy::counters) {
+        auto& c = get_counters();
+        c.*branch += 1;
+        c.bytes_written += bytes;
+    }
+}
+
+void nft::track_rows(table_stats nft_stats::* table, int64_t rows, int64_t bytes) {
+    if constexpr (policy::row_stats) {
+        auto& t = get_stats().*table;
+        t.rows  += rows;
+        t.bytes += bytes;
+    }
+}
+
+string nft::logged(const string& text) {
+    return get_config().event_mode == compact_events ? string() : text;
+}
+
+string nft::logged_memo(const string& memo, bool interned) {
+    if constexpr (!policy::log_memos) {
+        return string();
+    } else {
+        auto mode = get_config().memo_mode;
+        if (mode == memo_dropped || (mode == memo_interned && interned)) {
+            return string();
+        }
+        return logged(memo);
+    }
+}
+
+binary_extension<uint32_t> nft::memo_ref(const string& memo, const name& payer) {
+    if constexpr (!policy::log_memos) {
+        return {};
+    } else {
+        if (get_config().memo_mode != memo_interned || memo.empty()) {
+            return {};
+        }
+
+        // repeated memos hit the byhash index and cost no ram
+        auto hash = sha256(memo.data(), memo.size());
+        memos memostable(get_self(), get_self().value);
+        auto byhash = memostable.get_index<"byhash"_n>();
+        auto it = byhash.find(hash);
+        if (it != byhash.end()) {
+            return binary_extension<uint32_t>(uint32_t(it->memo_id));
+        }
+
+        uint64_t memo_id = std::max(memostable.available_primary_key(), uint64_t(1));
+        check(memo_id <= std::numeric_limits<uint32_t>::max(), "memo ids are exhausted");
+        memostable.emplace(payer, [&](auto& m) {
+            m.memo_id = memo_id;
+            m.hash    = hash;
+            m.memo    = memo;
+        });
+        return binary_extension<uint32_t>(uint32_t(memo_id));
+    }
+}
+
+template<typename T>
+void nft::emit(name event, const T& data) {
+    if (get_config().event_mode == return_events) {
+        _events.push_back(nft_event{event, pack(data)});
+    } else {
+        count_inline();
+        action(self_perm, _self, event, data).send();
+    }
+}
+
 void nft::createcol(const name& author, uint16_t royalty, const string& data) {
+    count_action("createcol"_n);
     require_auth(_self);
 
     check(royalty >= 0, "royalty must be positive");
-    check(royalty <= 1000, "royalty must be less than 1000");
-    check(data.size() <= 65535, "data has more than 65535 bytes");
+    check(royalty <= policy::max_royalty, policy::royalty_too_high);
+    check(data.size() <= policy::max_data_size, policy::data_too_long);
     check(is_account(author), "author account does not exist");
+    check(policy::onchain_metadata || data.empty(), "on-chain metadata is disabled, data must be empty");
 
     collections colstable(get_self(), get_self().value);
 
-    uint64_t collection_id = colstable.available_primary_key();
-    if (collection_id == 0) {
-        collection_id = 1;
-    }
+    uint64_t collection_id = next_collection_id();
 
-    colstable.emplace(_self, [&](auto& s) {
+    auto col_it = colstable.emplace(_self, [&](auto& s) {
         s.collection_id = collection_id;
         s.author        = author;
         s.royalty       = royalty;
         s.data          = data;
     });
+    track_rows(&nft_stats::collection_rows, 1, pack_size(*col_it));
 
     // collog
-    auto logdata = std::make_tuple(collection_id, author, royalty, data);
-    action(self_perm, _self, "collog"_n, logdata).send();
+    auto logdata = std::make_tuple(collection_id, author, royalty, logged(data));
+    emit("collog"_n, logdata);
+}
+
+void nft::setmetauri(uint64_t collection_id, const checksum256& hash, const string& uri) {
+    count_action("setmetauri"_n);
+    check(!uri.empty(), "uri must not be empty");
+    check(uri.size() <= 256, "uri has more than 256 bytes");
+
+    collections colstable(get_self(), get_self().value);
+    auto col_it = colstable.require_find(collection_id, "unable to find collection");
+    require_auth(col_it->author);
+    check(!col_it->offchain(), "collection metadata uri is already set");
+
+    int64_t before = pack_size(*col_it);
+    colstable.modify(col_it, same_payer, [&](auto& s) {
+        s.meta_hash.emplace(hash);
+        s.meta_uri.emplace(uri);
+    });
+    track_rows(&nft_stats::collection_rows, 0, int64_t(pack_size(*col_it)) - before);
+}
+
+void nft::settemplate(uint64_t collection_id, const string& tmpl) {
+    count_action("settemplate"_n);
+    check(policy::onchain_metadata, "on-chain metadata is disabled");
+    check(!tmpl.empty(), "template must not be empty");
+    check(tmpl.size() <= policy::max_data_size, policy::template_too_long);
+
+    collections colstable(get_self(), get_self().value);
+    auto col_it = colstable.require_find(collection_id, "unable to find collection");
+    require_auth(col_it->author);
+    // rows are stored with every extension written, an unset template reloads as empty
+    check(col_it->meta_template.value_or().empty(), "collection template is already set");
+
+    int64_t before = pack_size(*col_it);
+    colstable.modify(col_it, same_payer, [&](auto& s) {
+        // extensions are positional, an empty uri keeps the collection on-chain
+        if (!s.meta_uri.has_value()) {
+            s.meta_hash.emplace();
+            s.meta_uri.emplace();
+        }
+        s.meta_template.emplace(tmpl);
+    });
+    track_rows(&nft_stats::collection_rows, 0, int64_t(pack_size(*col_it)) - before);
+}
+
+void nft::compactcol(uint64_t collection_id, const string& data) {
+    count_action("compactcol"_n);
+    check(policy::onchain_metadata, "on-chain metadata is disabled");
+
+    collections colstable(get_self(), get_self().value);
+    auto col_it = colstable.require_find(collection_id, "unable to find collection");
+    require_auth(col_it->author);
+    check(data.size() < col_it->data.size(), "data must be shorter than the current data");
+
+    int64_t before = pack_size(*col_it);
+    colstable.modify(col_it, same_payer, [&](auto& s) {
+        s.data = data;
+    });
+    track_rows(&nft_stats::collection_rows, 0, int64_t(pack_size(*col_it)) - before);
+
+    // collog
+    auto logdata = std::make_tuple(collection_id, col_it->author, col_it->royalty, logged(data));
+    emit("collog"_n, logdata);
+}
+
+void nft::settrait(uint64_t collection_id, uint16_t trait_id, const string& trait_type, const vector<string>& values) {
+    count_action("settrait"_n);
+    check(!trait_type.empty(), "trait type must not be empty");
+    check(trait_type.size() <= 256, "trait type has more than 256 bytes");
+    check(!values.empty(), "trait must have values");
+    check(values.size() < no_trait_value, "trait has too many values");
+
+    collections colstable(get_self(), get_self().value);
+    auto col_it = colstable.require_find(collection_id, "unable to find collection");
+    require_auth(col_it->author);
+
+    traits traitstable(get_self(), collection_id);
+    auto it = traitstable.find(trait_id);
+    if (it == traitstable.end()) {
+        check(trait_id == 0 || traitstable.find(trait_id - 1) != traitstable.end(), "trait ids must be contiguous");
+        traitstable.emplace(col_it->author, [&](auto& t) {
+            t.trait_id   = trait_id;
+            t.trait_type = trait_type;
+            t.values     = values;
+        });
+    } else {
+        // assets refer to values by index, existing values can only be appended to
+        check(it->trait_type == trait_type, "trait type cannot change");
+        check(values.size() >= it->values.size() && std::equal(it->values.begin(), it->values.end(), values.begin()), "existing trait values cannot change");
+        traitstable.modify(it, col_it->author, [&](auto& t) {
+            t.values = values;
+        });
+    }
 }
 
 void nft::createasset(uint64_t collection_id, uint64_t supply, uint64_t max_supply, const string& data) {
+    count_action("createasset"_n);
+    check(!policy::unique_only, "only unique assets can be created, use createassets");
     check(max_supply > 0, "max-supply must be positive");
-    check(data.size() <= 65535, "data has more than 65535 bytes");
+    check(data.size() <= policy::max_data_size, policy::data_too_long);
 
     collections colstable(get_self(), get_self().value);
     auto col_it = colstable.require_find(collection_id, "unable to find collection");
@@ -37,37 +282,178 @@ void nft::createasset(uint64_t collection_id, uint64_t supply, uint64_t max_supp
 
     assets assetstable(get_self(), get_self().value);
 
-    uint64_t asset_id = assetstable.available_primary_key();
-    if (asset_id == 0) {
-        asset_id = 1;
-    }
+    uint64_t asset_id = next_asset_ids(1);
 
-    assetstable.emplace(col_it->author, [&](auto& s) {
+    auto ast_it = assetstable.emplace(col_it->author, [&](auto& s) {
         s.asset_id      = asset_id;
         s.collection_id = collection_id;
+        s.author        = col_it->author;
+        s.royalty       = col_it->royalty;
         s.supply        = 0;
         s.max_supply    = max_supply;
-        s.data          = data;
     });
+    track_rows(&nft_stats::asset_rows, 1, pack_size(*ast_it));
+
+    // assets of an off-chain collection keep no data row
+    if (!policy::onchain_metadata || col_it->offchain()) {
+        check(data.empty(), "collection metadata is off-chain, data must be empty");
+    } else {
+        assetdata datatable(get_self(), get_self().value);
+        auto data_it = datatable.emplace(col_it->author, [&](auto& s) {
+            s.asset_id      = asset_id;
+            s.data          = data;
+        });
+        track_rows(&nft_stats::asset_data_rows, 1, pack_size(*data_it));
+    }
 
     // assetlog
-    auto logdata = std::make_tuple(asset_id, collection_id, max_supply, data);
-    action(self_perm, _self, "assetlog"_n, logdata).send();
+    auto logdata = std::make_tuple(asset_id, collection_id, max_supply, logged(data));
+    emit("assetlog"_n, logdata);
 
     if (supply > 0) {
         mint(col_it->author, asset_id, supply, string("create and mint"));
     }
 }
 
-void nft::mint(const name& to, uint64_t asset_id, int64_t amount, const string& memo) {
-    check(memo.size() <= 256, "memo has more than 256 bytes");
+void nft::createassets(uint64_t collection_id, const vector<asset_spec>& specs) {
+    count_action("createassets"_n);
+    check(!specs.empty(), "no assets given");
+
+    collections colstable(get_self(), get_self().value);
+    auto col_it = colstable.require_find(collection_id, "unable to find collection");
+    require_auth(col_it->author);
 
+    assets assetstable(get_self(), get_self().value);
+    assetdata datatable(get_self(), get_self().value);
+    owners ownerstable(get_self(), get_self().value);
+    traits traitstable(get_self(), collection_id);
+
+    uint64_t first_id = next_asset_ids(specs.size());
+
+    vector<transfer_entry> entries;
+    uint64_t asset_id = first_id;
+    for (const auto& spec : specs) {
+        check(spec.max_supply > 0, "max-supply must be positive");
+        check(spec.supply <= spec.max_supply, "amount exceeds available supply");
+        check(!policy::unique_only || spec.unique, "only unique assets can be created");
+        check(!spec.unique || (spec.supply == 1 && spec.max_supply == 1), "unique asset must have supply and max-supply 1");
+        check(spec.data.size() <= policy::max_data_size, policy::data_too_long);
+
+        auto ast_it = assetstable.emplace(col_it->author, [&](auto& s) {
+            s.asset_id      = asset_id;
+            s.collection_id = collection_id;
+            s.author        = col_it->author;
+            s.royalty       = col_it->royalty;
+            s.supply        = spec.supply;
+            s.max_supply    = spec.max_supply;
+            s.is_unique     = spec.unique;
+        });
+        track_rows(&nft_stats::asset_rows, 1, pack_size(*ast_it));
+
+        if (spec.unique) {
+            ownerstable.emplace(col_it->author, [&](auto& o) {
+                o.asset_id = asset_id;
+                o.owner    = col_it->author;
+            });
+        }
+
+        if (!policy::onchain_metadata || col_it->offchain()) {
+            check(spec.data.empty(), "collection metadata is off-chain, data must be empty");
+        }
+        check_attributes(traitstable, spec.attributes);
+
+        if ((policy::onchain_metadata && !col_it->offchain()) || !spec.attributes.empty()) {
+            auto data_it = datatable.emplace(col_it->author, [&](auto& s) {
+                s.asset_id      = asset_id;
+                s.data          = spec.data;
+                s.attributes    = spec.attributes;
+            });
+            track_rows(&nft_stats::asset_data_rows, 1, pack_size(*data_it));
+        }
+
+        if (spec.unique) {
+            count_holding(col_it->author, collection_id, 1, col_it->author);
+            hash_balance(col_it->author, asset_id, 1);
+            entries.push_back(transfer_entry{col_it->author, asset_id, int64_t(1), int64_t(0), int64_t(1)});
+        } else if (spec.supply > 0) {
+            auto to_balance = add_balance(col_it->author, asset_id, collection_id, spec.supply, col_it->author);
+            entries.push_back(transfer_entry{col_it->author, asset_id, int64_t(spec.supply), int64_t(0), to_balance});
+        }
+        asset_id++;
+    }
+
+    // assets log
+    auto logdata = std::make_tuple(collection_id, first_id, asset_id - 1);
+    emit("assetslog"_n, logdata);
+
+    if (!entries.empty()) {
+        auto data = std::make_tuple(name(""), entries, logged_memo(string("create and mint")), memo_ref(string("create and mint"), col_it->author));
+        emit("transferslog"_n, data);
+    }
+}
+
+void nft::setattrs(uint64_t asset_id, const vector<uint16_t>& attributes) {
+    count_action("setattrs"_n);
+    assets assetstable(get_self(), get_self().value);
+    const auto& ast = assetstable.get(asset_id, "unable to find asset");
+    require_auth(ast.author);
+
+    traits traitstable(get_self(), ast.collection_id);
+    check_attributes(traitstable, attributes);
+
+    assetdata datatable(get_self(), get_self().value);
+    auto it = datatable.find(asset_id);
+    if (it == datatable.end()) {
+        it = datatable.emplace(ast.author, [&](auto& s) {
+            s.asset_id      = asset_id;
+            s.attributes    = attributes;
+        });
+        track_rows(&nft_stats::asset_data_rows, 1, pack_size(*it));
+    } else {
+        int64_t before = pack_size(*it);
+        datatable.modify(it, ast.author, [&](auto& s) {
+            s.attributes    = attributes;
+        });
+        track_rows(&nft_stats::asset_data_rows, 0, int64_t(pack_size(*it)) - before);
+    }
+}
+
+void nft::closeasset(uint64_t asset_id, bool erase) {
+    count_action("closeasset"_n);
     assets assetstable(get_self(), get_self().value);
     auto ast_it = assetstable.require_find(asset_id, "unable to find asset");
+    require_auth(ast_it->author);
+    check(ast_it->supply == 0, "asset still has supply");
 
-    collections colstable(get_self(), get_self().value);
-    auto col_it = colstable.require_find(ast_it->collection_id, "unable to find collection");
-    require_auth(col_it->author);
+    assetdata datatable(get_self(), get_self().value);
+    auto data_it = datatable.find(asset_id);
+    if (data_it != datatable.end()) {
+        track_rows(&nft_stats::asset_data_rows, -1, -int64_t(pack_size(*data_it)));
+        datatable.erase(data_it);
+    }
+
+    // assetlog, max_supply 0 marks the asset as closed
+    auto logdata = std::make_tuple(asset_id, ast_it->collection_id, uint64_t(0), string());
+    emit("assetlog"_n, logdata);
+
+    // ids are never reused, so the whole row can go
+    if (erase) {
+        track_rows(&nft_stats::asset_rows, -1, -int64_t(pack_size(*ast_it)));
+        assetstable.erase(ast_it);
+    } else {
+        assetstable.modify(ast_it, same_payer, [&](auto& s) {
+            s.max_supply = 0;
+        });
+    }
+}
+
+void nft::mint(const name& to, uint64_t asset_id, int64_t amount, const string& memo) {
+    count_action("mint"_n);
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
+
+    assets assetstable(get_self(), get_self().value);
+    auto ast_it = assetstable.require_find(asset_id, "unable to find asset");
+    require_auth(ast_it->author);
 
     check(amount > 0, "must issue positive amount");
     check(ast_it->max_supply >= ast_it->supply + amount, "amount exceeds available supply");
@@ -76,98 +462,863 @@ void nft::mint(const name& to, uint64_t asset_id, int64_t amount, const string&
         s.supply += amount;
     });
 
-    auto to_balance = add_balance(to, asset_id, amount, col_it->author);
+    auto author_balance = add_balance(ast_it->author, asset_id, ast_it->collection_id, amount, ast_it->author);
 
     // transfer log
-    auto data = std::make_tuple(name(""), col_it->author, asset_id, amount, int64_t(0), to_balance, memo);
-    action(self_perm, _self, "transferlog"_n, data).send();
+    // a chained transfer logs the memo itself
+    const string& log_memo = to != ast_it->author ? string() : memo;
+    auto data = std::make_tuple(name(""), ast_it->author, asset_id, amount, int64_t(0), author_balance, logged_memo(log_memo), memo_ref(log_memo, ast_it->author));
+    emit("transferlog"_n, data);
 
     // transfer
-    if (to != col_it->author) {
-        auto data = std::make_tuple(col_it->author, to, asset_id, amount, memo);
-        action(permission_level{col_it->author, "active"_n}, _self, "transfer"_n, data).send();
+    if (to != ast_it->author) {
+        auto data = std::make_tuple(ast_it->author, to, asset_id, amount, memo);
+        count_inline();
+        action(permission_level{ast_it->author, "active"_n}, _self, "transfer"_n, data).send();
     }
     
 }
 
-void nft::burn(uint64_t asset_id, int64_t amount, const string& memo) {
-    check(memo.size() <= 256, "memo has more than 256 bytes");
-    check(amount > 0, "must retire positive amount");
+void nft::mintto(const name& to, uint64_t asset_id, int64_t amount, const string& memo) {
+    count_action("mintto"_n);
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
 
     assets assetstable(get_self(), get_self().value);
     auto ast_it = assetstable.require_find(asset_id, "unable to find asset");
-    check(ast_it->supply >= amount, "insufficient amount");
+    require_auth(ast_it->author);
 
-    collections colstable(get_self(), get_self().value);
-    auto col_it = colstable.require_find(ast_it->collection_id, "unable to find collection");
-    require_auth(col_it->author);
+    check(amount > 0, "must issue positive amount");
+    check(ast_it->max_supply >= ast_it->supply + amount, "amount exceeds available supply");
 
     assetstable.modify(ast_it, same_payer, [&](auto& s) {
-       s.supply -= amount;
+        s.supply += amount;
     });
 
-    auto from_balance = sub_balance(col_it->author, asset_id, amount);
+    require_recipient(to);
+
+    // credit the recipient directly instead of going through the author's balance
+    auto to_balance = add_balance(to, asset_id, ast_it->collection_id, amount, ast_it->author);
 
     // transfer log
-    auto data = std::make_tuple(col_it->author, name(""), asset_id, amount, from_balance, int64_t(0), memo);
-    action(self_perm, _self, "transferlog"_n, data).send();
+    auto data = std::make_tuple(name(""), to, asset_id, amount, int64_t(0), to_balance, logged_memo(memo), memo_ref(memo, ast_it->author));
+    emit("transferlog"_n, data);
+}
+
+void nft::mintbatch(uint64_t asset_id, const vector<pair<name, int64_t>>& recipients, const string& memo) {
+    count_action("mintbatch"_n);
+    check(!recipients.empty(), "no recipients given");
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
+
+    assets assetstable(get_self(), get_self().value);
+    auto ast_it = assetstable.require_find(asset_id, "unable to find asset");
+    require_auth(ast_it->author);
+
+    uint64_t total = 0;
+    for (const auto& r : recipients) {
+        check(r.second > 0, "must issue positive amount");
+        check(uint64_t(r.second) <= ast_it->max_supply - ast_it->supply - total, "amount exceeds available supply");
+        total += r.second;
+    }
+
+    assetstable.modify(ast_it, same_payer, [&](auto& s) {
+        s.supply += total;
+    });
+
+    vector<name> notified;
+    vector<transfer_entry> entries;
+    entries.reserve(recipients.size());
+
+    for (const auto& r : recipients) {
+        auto it = std::lower_bound(notified.begin(), notified.end(), r.first);
+        if (it == notified.end() || *it != r.first) {
+            require_recipient(r.first);
+            notified.insert(it, r.first);
+        }
+
+        auto to_balance = add_balance(r.first, asset_id, ast_it->collection_id, r.second, ast_it->author);
+        entries.push_back(transfer_entry{r.first, asset_id, r.second, int64_t(0), to_balance});
+    }
+
+    // transfers log
+    auto data = std::make_tuple(name(""), entries, logged_memo(memo), memo_ref(memo, ast_it->author));
+    emit("transferslog"_n, data);
+}
+
+void nft::enqueue(uint64_t asset_id, const vector<pair<name, int64_t>>& recipients) {
+    count_action("enqueue"_n);
+    check(!recipients.empty(), "no recipients given");
+
+    assets assetstable(get_self(), get_self().value);
+    auto ast_it = assetstable.require_find(asset_id, "unable to find asset");
+    require_auth(ast_it->author);
+
+    uint64_t total = 0;
+    for (const auto& r : recipients) {
+        check(r.second > 0, "must issue positive amount");
+        check(uint64_t(r.second) <= ast_it->max_supply - ast_it->supply - total, "amount exceeds available supply");
+        check(is_account(r.first), "to account does not exist");
+        total += r.second;
+    }
+
+    // reserved up front so processing can never exceed max_supply
+    assetstable.modify(ast_it, same_payer, [&](auto& s) {
+        s.supply += total;
+    });
+
+    global globaltable(get_self(), get_self().value);
+    auto g = get_global(globaltable);
+
+    queue queuetable(get_self(), get_self().value);
+    for (const auto& r : recipients) {
+        queuetable.emplace(ast_it->author, [&](auto& q) {
+            q.id       = g.next_queue_id++;
+            q.asset_id = asset_id;
+            q.to       = r.first;
+            q.amount   = r.second;
+        });
+    }
+    globaltable.set(g, _self);
+}
+
+void nft::process(const name& cranker, uint32_t max_legs) {
+    count_action("process"_n);
+    require_auth(cranker);
+    check(max_legs > 0, "max_legs must be positive");
+
+    global globaltable(get_self(), get_self().value);
+    auto g = get_global(globaltable);
+
+    queue queuetable(get_self(), get_self().value);
+    auto it = queuetable.lower_bound(g.queue_cursor);
+    check(it != queuetable.end(), "queue is empty");
+
+    assets assetstable(get_self(), get_self().value);
+
+    vector<transfer_entry> entries;
+
+    // new rows are billed to the author when they crank and to the cranker otherwise, never to the contract.
+    // recipients are not notified, a rejecting recipient would otherwise block the whole queue
+    for (uint32_t i = 0; i < max_legs && it != queuetable.end(); i++) {
+        const auto& ast = assetstable.get(it->asset_id, "unable to find asset");
+        auto payer = has_auth(ast.author) ? ast.author : cranker;
+
+        auto to_balance = add_balance(it->to, it->asset_id, ast.collection_id, it->amount, payer);
+        entries.push_back(transfer_entry{it->to, it->asset_id, it->amount, int64_t(0), to_balance});
+
+        g.queue_cursor = it->id + 1;
+        it = queuetable.erase(it);
+    }
+    globaltable.set(g, _self);
+
+    // transfers log
+    auto data = std::make_tuple(name(""), entries, logged_memo(string("airdrop")), memo_ref(string("airdrop"), cranker));
+    emit("transferslog"_n, data);
+}
+
+void nft::burn(uint64_t asset_id, int64_t amount, const string& memo) {
+    count_action("burn"_n);
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
+    check(amount > 0, "must retire positive amount");
+
+    assets assetstable(get_self(), get_self().value);
+    auto ast_it = assetstable.require_find(asset_id, "unable to find asset");
+    require_auth(ast_it->author);
+
+    auto from_balance = retire(assetstable, *ast_it, ast_it->author, amount);
+
+    // transfer log
+    auto data = std::make_tuple(ast_it->author, name(""), asset_id, amount, from_balance, int64_t(0), logged_memo(memo), memo_ref(memo, ast_it->author));
+    emit("transferlog"_n, data);
+
+}
+
+void nft::redeem(const name& owner, uint64_t asset_id, int64_t amount, const string& memo) {
+    count_action("redeem"_n);
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
+    check(amount > 0, "must retire positive amount");
+    require_auth(owner);
+
+    assets assetstable(get_self(), get_self().value);
+    const auto& ast = assetstable.get(asset_id, "unable to find asset");
+
+    // burns from the holder's own balance, no transfer back to the author needed
+    auto from_balance = retire(assetstable, ast, owner, amount);
 
+    // transfer log
+    auto data = std::make_tuple(owner, name(""), asset_id, amount, from_balance, int64_t(0), logged_memo(memo, false));
+    emit("transferlog"_n, data);
 }
 
 void nft::transfer(const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo) {
+    count_action("transfer"_n);
     check(from != to, "cannot transfer to self");
     require_auth(from);
-    check(is_account(to), "to account does not exist");
 
+    do_transfer(from, to, asset_id, amount, memo, has_auth(to) ? to : from);
+}
+
+void nft::transfernn(const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo, bool notify_to) {
+    count_action("transfernn"_n);
+    check(from != to, "cannot transfer to self");
+    require_auth(from);
+
+    // for moves between custody accounts where notification handlers are pure overhead
+    do_transfer(from, to, asset_id, amount, memo, has_auth(to) ? to : from, notify_to ? nft::notify_to : notify_none);
+}
+
+void nft::transferfrom(const name& spender, const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo) {
+    count_action("transferfrom"_n);
+    check(from != to, "cannot transfer to self");
+    require_auth(spender);
+
+    if (spender != from) {
+        spend_allowance(from, spender, asset_id, amount);
+    }
+    do_transfer(from, to, asset_id, amount, memo, has_auth(to) ? to : spender);
+}
+
+void nft::settle(const name& spender, const name& token_contract, const vector<sale_leg>& legs, const string& memo) {
+    count_action("settle"_n);
+    require_auth(spender);
+    check(!legs.empty(), "no sales given");
+    check(is_account(token_contract), "token contract does not exist");
+
+    assets assetstable(get_self(), get_self().value);
+
+    vector<pair<name, asset>> payouts;
+    for (const auto& leg : legs) {
+        check(leg.from != leg.to, "cannot transfer to self");
+        check(leg.price.is_valid(), "invalid price");
+        check(leg.price.amount >= 0, "price must not be negative");
+
+        if (spender != leg.from) {
+            spend_allowance(leg.from, spender, leg.asset_id, leg.amount);
+        }
+        do_transfer(leg.from, leg.to, leg.asset_id, leg.amount, memo, has_auth(leg.to) ? leg.to : spender);
+
+        // royalty is in 1/10000 of the price
+        const auto& ast = assetstable.get(leg.asset_id, "unable to find asset");
+        int64_t royalty = static_cast<int64_t>(static_cast<__int128>(leg.price.amount) * ast.royalty / 10000);
+        if (royalty == 0 || ast.author == spender) {
+            continue;
+        }
+
+        auto it = std::find_if(payouts.begin(), payouts.end(), [&](const auto& p) {
+            return p.first == ast.author && p.second.symbol == leg.price.symbol;
+        });
+        if (it == payouts.end()) {
+            payouts.emplace_back(ast.author, asset(royalty, leg.price.symbol));
+        } else {
+            it->second += asset(royalty, leg.price.symbol);
+        }
+    }
+
+    // one payout per author and symbol, spender must grant eosio.code of this contract
+    for (const auto& p : payouts) {
+        auto data = std::make_tuple(spender, p.first, p.second, memo);
+        count_inline();
+        action(permission_level{spender, "active"_n}, token_contract, "transfer"_n, data).send();
+    }
+}
+
+void nft::approve(const name& owner, const name& spender, uint64_t asset_id, int64_t amount) {
+    count_action("approve"_n);
+    require_auth(owner);
+    check(owner != spender, "cannot approve self");
+    check(amount >= 0, "amount must not be negative");
+    check(is_account(spender), "spender account does not exist");
+
+    assets assetstable(get_self(), get_self().value);
+    assetstable.get(asset_id, "unable to find asset");
+
+    approvals approvalstable(get_self(), owner.value);
+    auto it = approvalstable.find(spender.value);
+    if (it == approvalstable.end()) {
+        check(amount > 0, "no approval found");
+        approvalstable.emplace(owner, [&](auto& a) {
+            a.spender    = spender;
+            a.all_assets = false;
+            a.allowances.push_back(asset_allowance{asset_id, amount});
+        });
+        return;
+    }
+
+    // amount 0 revokes the approval of this asset
+    approvalstable.modify(it, owner, [&](auto& a) {
+        auto al = std::find_if(a.allowances.begin(), a.allowances.end(), [&](const auto& al) { return al.asset_id == asset_id; });
+        if (al == a.allowances.end()) {
+            if (amount > 0) {
+                a.allowances.push_back(asset_allowance{asset_id, amount});
+            }
+        } else if (amount > 0) {
+            al->amount = amount;
+        } else {
+            a.allowances.erase(al);
+        }
+    });
+    if (!it->all_assets && it->allowances.empty()) {
+        approvalstable.erase(it);
+    }
+}
+
+void nft::approveall(const name& owner, const name& spender, bool approved) {
+    count_action("approveall"_n);
+    require_auth(owner);
+    check(owner != spender, "cannot approve self");
+
+    approvals approvalstable(get_self(), owner.value);
+    auto it = approvalstable.find(spender.value);
+    if (it == approvalstable.end()) {
+        check(approved, "no approval found");
+        check(is_account(spender), "spender account does not exist");
+        approvalstable.emplace(owner, [&](auto& a) {
+            a.spender    = spender;
+            a.all_assets = true;
+        });
+    } else if (approved || !it->allowances.empty()) {
+        approvalstable.modify(it, same_payer, [&](auto& a) {
+            a.all_assets = approved;
+        });
+    } else {
+        approvalstable.erase(it);
+    }
+}
+
+void nft::do_transfer(const name& from, const name& to, uint64_t asset_id, int64_t amount, const string& memo, const name& ram_payer, uint8_t notify) {
     assets assetstable(get_self(), get_self().value);
     const auto& ast = assetstable.get(asset_id, "unable to find asset");
 
-    require_recipient(from);
-    require_recipient(to);
+    if (notify & notify_from) {
+        require_recipient(from);
+    }
+    if (notify & notify_to) {
+        require_recipient(to);
+    }
 
     check(amount > 0, "must transfer positive amount");
-    check(memo.size() <= 256, "memo has more than 256 bytes");
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
 
-    auto payer = has_auth(to) ? to : from;
+    int64_t from_balance = 0;
+    int64_t to_balance = 1;
+    if constexpr (policy::unique_only) {
+        // no balance rows exist in a unique-only build
+        check(ast.unique(), "only unique assets can be transferred");
+        move_unique(ast, from, to, amount, ram_payer);
+    } else if (ast.unique()) {
+        move_unique(ast, from, to, amount, ram_payer);
+    } else {
+        from_balance = sub_balance(from, asset_id, amount, ram_payer);
+        to_balance = add_balance(to, asset_id, ast.collection_id, amount, ram_payer);
+    }
 
-    auto from_balance = sub_balance(from, asset_id, amount);
-    auto to_balance = add_balance(to, asset_id, amount, payer);
+    // a transfer chained by mint carries the author's campaign memo and is interned like mint's own events
+    bool chained = get_sender() == get_self();
+    auto memo_id = chained ? memo_ref(memo, ram_payer) : binary_extension<uint32_t>();
 
     // transfer log
-    auto data = std::make_tuple(from, to, asset_id, amount, from_balance, to_balance, memo);
-    action(self_perm, _self, "transferlog"_n, data).send();
+    auto data = std::make_tuple(from, to, asset_id, amount, from_balance, to_balance, logged_memo(memo, chained), memo_id);
+    emit("transferlog"_n, data);
+}
+
+void nft::move_unique(const nft_asset& ast, const name& from, const name& to, int64_t amount, const name& ram_payer) {
+    check(amount == 1, "unique asset amount must be 1");
+
+    owners ownerstable(get_self(), get_self().value);
+    const auto& own = ownerstable.get(ast.asset_id, "no balance object found");
+    check(own.owner == from, "no balance object found");
+    check(is_account(to), "to account does not exist");
+
+    // one row modify instead of a balance erase and emplace in two scopes
+    ownerstable.modify(own, same_payer, [&](auto& o) {
+        o.owner = to;
+    });
+    count_write(&nft_counters::unique_moves, pack_size(own));
+
+    count_holding(from, ast.collection_id, -1, from);
+    count_holding(to, ast.collection_id, 1, ram_payer);
+    hash_balance(from, ast.asset_id, 0);
+    hash_balance(to, ast.asset_id, 1);
+}
+
+int64_t nft::retire(assets& assetstable, const nft_asset& ast, const name& owner, int64_t amount) {
+    check(ast.supply >= amount, "insufficient amount");
+
+    // a burned unique asset is closed, it has no balance row to re-mint into
+    if (ast.unique()) {
+        owners ownerstable(get_self(), get_self().value);
+        const auto& own = ownerstable.get(ast.asset_id, "no balance object found");
+        check(own.owner == owner, "no balance object found");
+        ownerstable.erase(own);
+        assetstable.modify(ast, same_payer, [&](auto& s) {
+            s.supply     = 0;
+            s.max_supply = 0;
+        });
+        count_holding(owner, ast.collection_id, -1, owner);
+        hash_balance(owner, ast.asset_id, 0);
+        return 0;
+    }
+
+    assetstable.modify(ast, same_payer, [&](auto& s) {
+       s.supply -= amount;
+    });
+    return sub_balance(owner, ast.asset_id, amount, owner);
+}
+
+void nft::spend_allowance(const name& owner, const name& spender, uint64_t asset_id, int64_t amount) {
+    approvals approvalstable(get_self(), owner.value);
+    const auto& approval = approvalstable.get(spender.value, "no approval found");
+    if (approval.all_assets) {
+        return;
+    }
 
+    auto al = std::find_if(approval.allowances.begin(), approval.allowances.end(), [&](const auto& al) { return al.asset_id == asset_id; });
+    check(al != approval.allowances.end(), "no approval found for asset");
+    check(al->amount >= amount, "amount exceeds approval");
+
+    if (al->amount == amount && approval.allowances.size() == 1) {
+        approvalstable.erase(approval);
+        return;
+    }
+
+    auto index = al - approval.allowances.begin();
+    approvalstable.modify(approval, same_payer, [&](auto& a) {
+        if (a.allowances[index].amount == amount) {
+            a.allowances.erase(a.allowances.begin() + index);
+        } else {
+            a.allowances[index].amount -= amount;
+        }
+    });
 }
 
-int64_t nft::sub_balance(const name& owner, uint64_t asset_id, int64_t amount) {
+void nft::setconfig(const nft_config& cfg) {
+    count_action("setconfig"_n);
+    require_auth(_self);
+    check(cfg.event_mode <= return_events, "unknown event mode");
+    check(cfg.memo_mode <= memo_interned, "unknown memo mode");
+
+    config configtable(get_self(), get_self().value);
+    configtable.set(cfg, _self);
+    _config = cfg;
+}
+
+void nft::migrate(uint32_t max_rows) {
+    count_action("migrate"_n);
+    require_auth(_self);
+    check(max_rows > 0, "max_rows must be positive");
+
+    legacy_assets legacytable(get_self(), get_self().value);
+    assets assetstable(get_self(), get_self().value);
+    assetdata datatable(get_self(), get_self().value);
+    collections colstable(get_self(), get_self().value);
+
+    // moved rows are billed to the contract, erasing the legacy row refunds the author
+    auto it = legacytable.begin();
+    for (uint32_t i = 0; i < max_rows && it != legacytable.end(); i++) {
+        const auto& col = colstable.get(it->collection_id, "unable to find collection");
+        auto ast_it = assetstable.emplace(_self, [&](auto& s) {
+            s.asset_id      = it->asset_id;
+            s.collection_id = it->collection_id;
+            s.author        = col.author;
+            s.royalty       = col.royalty;
+            s.supply        = it->supply;
+            s.max_supply    = it->max_supply;
+        });
+        auto data_it = datatable.emplace(_self, [&](auto& s) {
+            s.asset_id      = it->asset_id;
+            s.data          = it->data;
+        });
+        track_rows(&nft_stats::asset_rows, 1, pack_size(*ast_it));
+        track_rows(&nft_stats::asset_data_rows, 1, pack_size(*data_it));
+        it = legacytable.erase(it);
+    }
+}
+
+void nft::transfers(const name& from, const vector<transfer_leg>& legs, const string& memo) {
+    count_action("transfers"_n);
+    require_auth(from);
+    check(!legs.empty(), "no transfers given");
+    check(memo.size() <= policy::max_memo_size, policy::memo_too_long);
+
+    assets assetstable(get_self(), get_self().value);
+    balances from_blns(get_self(), from.value);
+
+    require_recipient(from);
+
+    vector<name> notified;
+    vector<transfer_entry> entries;
+    entries.reserve(legs.size());
+
+    for (const auto& leg : legs) {
+        check(from != leg.to, "cannot transfer to self");
+        check(leg.amount > 0, "must transfer positive amount");
+
+        // repeated asset ids are served from the multi_index cache
+        const auto& ast = assetstable.get(leg.asset_id, "unable to find asset");
+
+        auto it = std::lower_bound(notified.begin(), notified.end(), leg.to);
+        if (it == notified.end() || *it != leg.to) {
+            require_recipient(leg.to);
+            notified.insert(it, leg.to);
+        }
+
+        auto payer = has_auth(leg.to) ? leg.to : from;
+
+        int64_t from_balance = 0;
+        int64_t to_balance = 1;
+        if constexpr (policy::unique_only) {
+            check(ast.unique(), "only unique assets can be transferred");
+            move_unique(ast, from, leg.to, leg.amount, payer);
+        } else if (ast.unique()) {
+            move_unique(ast, from, leg.to, leg.amount, payer);
+        } else {
+            from_balance = sub_balance(from_blns, from, leg.asset_id, leg.amount, payer);
+            to_balance = add_balance(leg.to, leg.asset_id, ast.collection_id, leg.amount, payer);
+        }
+
+        entries.push_back(transfer_entry{leg.to, leg.asset_id, leg.amount, from_balance, to_balance});
+    }
+
+    // transfers log
+    auto data = std::make_tuple(from, entries, logged_memo(memo, false));
+    emit("transferslog"_n, data);
+}
+
+void nft::newepoch() {
+    count_action("newepoch"_n);
+    require_auth(_self);
+
+    // the closing root stays readable in its row, the next epoch chains from it
+    auto closing = get_epoch();
+    save_epoch();
+    _epoch = nft_epoch{closing.epoch + 1, closing.root, 0, current_time_point()};
+}
+
+void nft::reindex(const name& owner, uint64_t from_asset_id, uint32_t max_rows) {
+    count_action("reindex"_n);
+    require_auth(owner);
+    check(max_rows > 0, "max_rows must be positive");
+
+    assets assetstable(get_self(), get_self().value);
+    balances blns(get_self(), owner.value);
+
+    // rows without collection_id cannot be modified into the index, they are re-created paid by the owner.
+    // a legacy row rewritten by a balance update reloads with collection_id 0 and is still missing
+    auto it = blns.lower_bound(from_asset_id);
+    for (uint32_t i = 0; i < max_rows && it != blns.end(); i++) {
+        if (it->collection_id.value_or(0) != 0) {
+            it++;
+            continue;
+        }
+
+        const auto& ast = assetstable.get(it->asset_id, "unable to find asset");
+        auto row = *it;
+        track_rows(&nft_stats::balance_rows, 0, -int64_t(pack_size(row)));
+        it = blns.erase(it);
+
+        auto new_it = blns.emplace(owner, [&](auto& a) {
+            a.asset_id = row.asset_id;
+            a.balance  = row.balance;
+            a.collection_id.emplace(ast.collection_id);
+        });
+        track_rows(&nft_stats::balance_rows, 0, pack_size(*new_it));
+        count_holding(owner, ast.collection_id, 1, owner);
+    }
+}
+
+void nft::rebuildsum(const name& owner) {
+    count_action("rebuildsum"_n);
+    check(get_config().owner_summary, "owner summary is disabled");
+    auto payer = has_auth(owner) ? owner : _self;
+    if (payer == _self) {
+        require_auth(_self);
+    }
+
+    // recount with the rules count_holding applies, rows without collection_id are counted by reindex
+    vector<pair<uint64_t, uint64_t>> counts;
+    auto count = [&](uint64_t collection_id) {
+        for (uint64_t key : {collection_id, uint64_t(0)}) {
+            auto it = std::lower_bound(counts.begin(), counts.end(), key, [](const auto& c, uint64_t k) { return c.first < k; });
+            if (it == counts.end() || it->first != key) {
+                it = counts.insert(it, {key, 0});
+            }
+            it->second++;
+        }
+    };
+
+    balances blns(get_self(), owner.value);
+    for (const auto& b : blns) {
+        if (b.collection_id.value_or(0) != 0) {
+            count(b.collection_id.value());
+        }
+    }
+
+    assets assetstable(get_self(), get_self().value);
+    owners ownerstable(get_self(), get_self().value);
+    auto byowner = ownerstable.get_index<"byowner"_n>();
+    for (auto it = byowner.lower_bound(owner.value); it != byowner.end() && it->owner == owner; it++) {
+        count(assetstable.get(it->asset_id, "unable to find asset").collection_id);
+    }
+
+    // both are sorted by collection_id, rows are updated in place where possible
+    summaries summarytable(get_self(), owner.value);
+    auto c = counts.begin();
+    for (auto it = summarytable.begin(); it != summarytable.end(); ) {
+        for (; c != counts.end() && c->first < it->collection_id; c++) {
+            summarytable.emplace(payer, [&](auto& s) {
+                s.collection_id = c->first;
+                s.assets        = c->second;
+            });
+        }
+        if (c != counts.end() && c->first == it->collection_id) {
+            if (it->assets != c->second) {
+                summarytable.modify(it, same_payer, [&](auto& s) {
+                    s.assets = c->second;
+                });
+            }
+            c++;
+            it++;
+        } else {
+            it = summarytable.erase(it);
+        }
+    }
+    for (; c != counts.end(); c++) {
+        summarytable.emplace(payer, [&](auto& s) {
+            s.collection_id = c->first;
+            s.assets        = c->second;
+        });
+    }
+}
+
+void nft::setstats(const nft_stats& seed) {
+    count_action("setstats"_n);
+    require_auth(_self);
+    check(policy::row_stats, "row accounting is disabled in this build");
+
+    // seeds the counters with rows that existed before accounting was deployed
+    _stats = seed;
+}
+
+nft::nft_stats nft::getstats() {
+    stats statstable(get_self(), get_self().value);
+    return statstable.get_or_default();
+}
+
+nft::nft_counters nft::getcounters() {
+    counters counterstable(get_self(), get_self().value);
+    return counterstable.get_or_default();
+}
+
+#ifdef NFT_BENCHMARK
+void nft::benchbalance(const name& owner, uint64_t asset_id, uint32_t iterations) {
+    require_auth(owner);
+    // each iteration is the balance work of one transfer; 0 iterations measures the fixed action overhead,
+    // so (cpu(n) - cpu(0)) / n is the per transfer cost
+    assets assetstable(get_self(), get_self().value);
+    const auto& ast = assetstable.get(asset_id, "unable to find asset");
+
+    balances blns(get_self(), owner.value);
+    for (uint32_t i = 0; i < iterations; i++) {
+        add_balance(blns, owner, asset_id, ast.collection_id, 1, owner);
+        sub_balance(blns, owner, asset_id, 1, owner);
+    }
+}
+#endif
+
+nft::nft_global nft::get_global(global& globaltable) {
+    if (globaltable.exists()) {
+        return globaltable.get();
+    }
+
+    // first allocation on this deployment, continue after the highest existing ids
+    collections colstable(get_self(), get_self().value);
+    assets assetstable(get_self(), get_self().value);
+    legacy_assets legacytable(get_self(), get_self().value);
+
+    nft_global g;
+    g.next_collection_id = std::max(colstable.available_primary_key(), uint64_t(1));
+    g.next_asset_id = std::max({assetstable.available_primary_key(), legacytable.available_primary_key(), uint64_t(1)});
+    return g;
+}
+
+uint64_t nft::next_collection_id() {
+    global globaltable(get_self(), get_self().value);
+    auto g = get_global(globaltable);
+
+    uint64_t collection_id = g.next_collection_id++;
+    globaltable.set(g, _self);
+    return collection_id;
+}
+
+uint64_t nft::next_asset_ids(uint64_t count) {
+    global globaltable(get_self(), get_self().value);
+    auto g = get_global(globaltable);
+
+    uint64_t first_id = g.next_asset_id;
+    g.next_asset_id += count;
+    globaltable.set(g, _self);
+    return first_id;
+}
+
+int64_t nft::sub_balance(const name& owner, uint64_t asset_id, int64_t amount, const name& ram_payer) {
     balances from_blns(get_self(), owner.value);
+    return sub_balance(from_blns, owner, asset_id, amount, ram_payer);
+}
 
+int64_t nft::sub_balance(balances& from_blns, const name& owner, uint64_t asset_id, int64_t amount, const name& ram_payer) {
     const auto& from = from_blns.get(asset_id, "no balance object found");
     check(from.balance >= amount, "overdrawn balance");
 
+    int64_t balance = 0;
     if (from.balance == amount) {
+        track_rows(&nft_stats::balance_rows, -1, -int64_t(pack_size(from)));
+        count_write(&nft_counters::balance_erases, 0);
+        // rows without collection_id were never counted, collection ids start at 1
+        if (from.collection_id.value_or(0) != 0) {
+            count_holding(owner, from.collection_id.value(), -1, owner);
+        }
         from_blns.erase(from);
-        return 0;
     } else {
-        from_blns.modify(from, owner, [&](auto& a) {
-            a.balance -= amount;
+        // the owner takes over the row's ram only when they signed, approved spenders leave it as is
+        from_blns.modify(from, has_auth(owner) ? owner : same_payer, [&](auto& a) {
+            balance = a.balance -= amount;
         });
+        count_write(&nft_counters::balance_modifies, pack_size(from));
+    }
+
+    if (get_config().holder_index) {
+        // a missing holder row is re-created on the same terms as the balances row
+        update_holder(asset_id, owner, balance, has_auth(owner) ? owner : ram_payer);
     }
-    return from.balance;
+    hash_balance(owner, asset_id, balance);
+    return balance;
 }
 
-int64_t nft::add_balance(const name& owner, uint64_t asset_id, int64_t amount, const name& ram_payer) {
+int64_t nft::add_balance(const name& owner, uint64_t asset_id, uint64_t collection_id, int64_t amount, const name& ram_payer) {
     balances to_blns(get_self(), owner.value);
+    return add_balance(to_blns, owner, asset_id, collection_id, amount, ram_payer);
+}
+
+int64_t nft::add_balance(balances& to_blns, const name& owner, uint64_t asset_id, uint64_t collection_id, int64_t amount, const name& ram_payer) {
     auto to = to_blns.find(asset_id);
+
+    int64_t balance = amount;
     if (to == to_blns.end()) {
+        // an existing row already proves the account exists
+        check(is_account(owner), "to account does not exist");
         to = to_blns.emplace(ram_payer, [&](auto& a){
             a.asset_id = asset_id;
             a.balance = amount;
+            a.collection_id.emplace(collection_id);
         });
+        track_rows(&nft_stats::balance_rows, 1, pack_size(*to));
+        count_write(&nft_counters::balance_emplaces, pack_size(*to));
+        count_holding(owner, collection_id, 1, ram_payer);
     } else {
         to_blns.modify(to, same_payer, [&](auto& a) {
-            a.balance += amount;
+            balance = a.balance += amount;
+        });
+        count_write(&nft_counters::balance_modifies, pack_size(*to));
+    }
+
+    if (get_config().holder_index) {
+        update_holder(asset_id, owner, balance, ram_payer);
+    }
+    hash_balance(owner, asset_id, balance);
+    return balance;
+}
+
+void nft::check_attributes(traits& traitstable, const vector<uint16_t>& attributes) {
+    check(attributes.size() < no_trait_value, "too many attributes");
+    for (size_t trait_id = 0; trait_id < attributes.size(); trait_id++) {
+        if (attributes[trait_id] == no_trait_value) {
+            continue;
+        }
+        const auto& trait = traitstable.get(trait_id, "unable to find trait");
+        check(attributes[trait_id] < trait.values.size(), "unknown trait value");
+    }
+}
+
+nft::nft_epoch& nft::get_epoch() {
+    if (!_epoch) {
+        epochs epochstable(get_self(), get_self().value);
+        auto it = epochstable.end();
+        if (it == epochstable.begin()) {
+            _epoch = nft_epoch{1, checksum256(), 0, current_time_point()};
+        } else {
+            _epoch = *(--it);
+        }
+    }
+    return *_epoch;
+}
+
+void nft::save_epoch() {
+    epochs epochstable(get_self(), get_self().value);
+    auto it = epochstable.find(_epoch->epoch);
+    if (it == epochstable.end()) {
+        epochstable.emplace(_self, [&](auto& e) {
+            e = *_epoch;
+        });
+    } else {
+        epochstable.modify(it, same_payer, [&](auto& e) {
+            e = *_epoch;
+        });
+    }
+}
+
+void nft::hash_balance(const name& owner, uint64_t asset_id, int64_t balance) {
+    if (!get_config().snapshot_hash) {
+        return;
+    }
+
+    auto& e = get_epoch();
+    auto packed = pack(std::make_tuple(e.root, owner, asset_id, balance));
+    e.root = sha256(packed.data(), packed.size());
+    e.updates++;
+}
+
+void nft::count_holding(const name& owner, uint64_t collection_id, int64_t delta, const name& ram_payer) {
+    if (!get_config().owner_summary) {
+        return;
+    }
+
+    summaries summarytable(get_self(), owner.value);
+    for (uint64_t key : {collection_id, uint64_t(0)}) {
+        auto it = summarytable.find(key);
+        if (it == summarytable.end()) {
+            // holdings from before the summary was enabled are not counted
+            if (delta > 0) {
+                summarytable.emplace(ram_payer, [&](auto& s) {
+                    s.collection_id = key;
+                    s.assets        = delta;
+                });
+            }
+        } else if (int64_t(it->assets) + delta <= 0) {
+            summarytable.erase(it);
+        } else {
+            summarytable.modify(it, same_payer, [&](auto& s) {
+                s.assets += delta;
+            });
+        }
+    }
+}
+
+void nft::update_holder(uint64_t asset_id, const name& owner, int64_t balance, const name& ram_payer) {
+    holders holderstable(get_self(), asset_id);
+    auto it = holderstable.find(owner.value);
+
+    if (balance == 0) {
+        if (it != holderstable.end()) {
+            holderstable.erase(it);
+        }
+    } else if (it == holderstable.end()) {
+        // also picks up holders that predate enabling the index
+        holderstable.emplace(ram_payer, [&](auto& h) {
+            h.owner   = owner;
+            h.balance = balance;
+        });
+    } else {
+        holderstable.modify(it, same_payer, [&](auto& h) {
+            h.balance = balance;
         });
     }
-    return to->balance;
 }
\ No newline at end of file